@@ -4,6 +4,7 @@
  * Author: Jaffar Alzeidi
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,7 @@
 #include <sys/wait.h>
 #include <libgen.h>
 #include "built-ins.h"
+#include "placement.h"
 
 /*
  * Change the current working directory
@@ -148,15 +150,39 @@ void help(int argc, char **argv) {
 
 /*
  * Pause shell execution until enter is pressed
+ * Also returns at end of input, e.g. when stdin is /dev/null for a batch streamed through 'jshell -'
  */
 void pause_shell(int argc, char **argv) {
-    while(getchar() != '\n');
+    int c;
+    while((c = getchar()) != '\n' && c != EOF);
+    clearerr(stdin);
 }
 
 void quit(int argc, char **argv) {
     exit(0);
 }
 
+/*
+ * Show or change the placement applied to every program the shell forks
+ * With no args, print the current placement. 'place -r' resets it, otherwise the options
+ * (-c <cpu list>, -n <nice>, -i <class>[:<level>], -a) are merged into the current placement
+ */
+void place(int argc, char **argv) {
+    if(argc == 1) {
+        print_placement(shell_placement());
+    } else if(argc == 2 && strcmp(argv[1], "-r") == 0) {
+        init_placement(shell_placement());
+    } else {
+        struct placement p;
+        init_placement(&p);
+        if(parse_placement(&p, argc - 1, argv + 1) != argc - 1) {
+            fprintf(stderr, "%s", "Invalid args\n");
+            return;
+        }
+        merge_placement(shell_placement(), &p);
+    }
+}
+
 /*
  * Searches array of built-ins for a built-in that matches the command name
  */
@@ -194,4 +220,7 @@ void store_builtins(struct built_in *b) {
 
     b[8].name = "quit";
     b[8].func = quit;
+
+    b[9].name = "place";
+    b[9].func = place;
 }
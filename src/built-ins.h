@@ -4,7 +4,7 @@
  * Author: Jaffar Alzeidi
  */
 
-#define NUM_OF_BUILT_INS 9
+#define NUM_OF_BUILT_INS 10
 
 //stores the name of a command with a pointer to its function
 //an array of this struct is used to easily look up valid built-in commands and call
@@ -24,6 +24,7 @@ void echo(int argc, char **argv);
 void help(int argc, char **argv);
 void pause_shell(int argc, char **argv);
 void quit(int argc, char **argv);
+void place(int argc, char **argv);
 
 //utilities for finding and storing built-ins
 int find_builtin(char *command, struct built_in *b);
@@ -14,6 +14,7 @@
 #include "vector.h"
 
 void init_program_data(struct program_data *p, char **argv, int argc);
+char *next_token(char **command);
 
 char **tokenize_command(char *command, int *next) {
     int capacity = 8;
@@ -22,12 +23,12 @@ char **tokenize_command(char *command, int *next) {
         perror("malloc");
 	    exit(1);
     }
-    char *token = strtok(command, " \t\n");
+    char *token = next_token(&command);
     while(token != NULL) {
         tokens = check_vector(tokens, &capacity, *next);
         tokens[*next] = token;
         ++*next;
-        token = strtok(NULL, " \t\n");
+        token = next_token(&command);
     }
     tokens = check_vector(tokens, &capacity, *next);
     tokens[*next] = NULL;
@@ -35,9 +36,49 @@ char **tokenize_command(char *command, int *next) {
     return tokens;
 }
 
+/*
+ * Works like strtok with whitespace delimiters, except that whitespace inside '$(...)' does not end
+ * the token, so that a command substitution reaches the parser in one piece
+ * '*command' is advanced past the returned token, NULL is returned when no tokens are left
+ */
+char *next_token(char **command) {
+    char *c = *command;
+    while(*c == ' ' || *c == '\t' || *c == '\n') ++c;
+    if(*c == '\0') {
+        *command = c;
+        return NULL;
+    }
+    char *token = c;
+    int depth = 0;      //how many '$(' are still waiting for their ')'
+    while(*c != '\0' && (depth > 0 || (*c != ' ' && *c != '\t' && *c != '\n'))) {
+        if(c[0] == '$' && c[1] == '(') {
+            ++depth;
+            ++c;
+        } 
+        else if(*c == ')' && depth > 0) --depth;
+        ++c;
+    }
+    if(*c != '\0') *c++ = '\0';
+    *command = c;
+    return token;
+}
+
+char *substitution_end(char *token) {
+    if(token[0] != '$' || token[1] != '(') return NULL;
+    int depth = 0;
+    for(char *c = token; *c != '\0'; c++) {
+        if(c[0] == '$' && c[1] == '(') {
+            ++depth;
+            ++c;
+        }
+        else if(*c == ')' && --depth == 0) return c;
+    }
+    return NULL;
+}
+
 /*
  * Takes an array of strings 'tokens', and parses it to produce an array of program_data structs (pdata) 
- * The word 'operator' will be used to refer to the following: '>', '>>', '<', '|', '&'
+ * The word 'operator' will be used to refer to the following: '>', '>>', '<', '<<', '<<<', '|', '&'
  * This function loops over every string in tokens, looking for operators
  * The first operator to be found marks the end of the argv array for the current element of pdata
  * Every time a '|' is encountered there is a new program, because pipe by definition chains programs
@@ -56,12 +97,14 @@ int parse_command(struct program_data ***pdata, int *next, char **tokens, int si
 
     for(int i = 0; i < size - 1; i++) {
         int redir_in = strcmp(tokens[i], "<") == 0; 
+        int here_doc = strcmp(tokens[i], "<<") == 0;
+        int here_string = strcmp(tokens[i], "<<<") == 0;
         int redir_out = strcmp(tokens[i], ">") == 0;
         int redir_out_append = strcmp(tokens[i], ">>") == 0;
         int do_pipe = strcmp(tokens[i], "|") == 0;
         int run_daemon = strcmp(tokens[i], "&") == 0;
 
-        if(redir_in || redir_out || redir_out_append || do_pipe ||  run_daemon) {
+        if(redir_in || here_doc || here_string || redir_out || redir_out_append || do_pipe ||  run_daemon) {
             if(i - 1 < arg_start || (!run_daemon && (i + 1 >= size - 1))) {
                 fprintf(stderr, "%s", "An error has occurred\n");
 		        return -1;   
@@ -76,7 +119,21 @@ int parse_command(struct program_data ***pdata, int *next, char **tokens, int si
             if(redir_in) {
 	            (*pdata)[*next]->input_file = tokens[i + 1];
 		        i++;
-	        } else if(redir_out || redir_out_append) {
+	        } else if(here_doc) {
+                //the body is read later by the shell, we only know where it ends
+                (*pdata)[*next]->heredoc_end = tokens[i + 1];
+                i++;
+            } else if(here_string) {
+                size_t length = strlen(tokens[i + 1]);
+                char *text = malloc(length + 2);
+                memcpy(text, tokens[i + 1], length);
+                text[length] = '\n';
+                text[length + 1] = '\0';
+                free((*pdata)[*next]->here_input);
+                (*pdata)[*next]->here_input = text;
+                (*pdata)[*next]->here_length = length + 1;
+                i++;
+            } else if(redir_out || redir_out_append) {
 	            (*pdata)[*next]->output_file = tokens[i + 1];
 		        i++;
 		        if(redir_out_append) (*pdata)[*next]->append_output = true;
@@ -105,4 +162,21 @@ void init_program_data(struct program_data *p, char **argv, int argc) {
     p->append_output = false;
     p->is_piped = false;
     p->is_daemon = false;
+    p->expanded_argv = NULL;
+    p->expansion = NULL;
+    p->heredoc_end = NULL;
+    p->here_input = NULL;
+    p->here_length = 0;
+    p->resolved_name = NULL;
+    p->resolved_generation = 0;
+    p->exec_path = NULL;
+    p->ibuilt_in = -1;
+}
+
+void free_program_data(struct program_data *p) {
+    free(p->expanded_argv);
+    free(p->expansion);
+    free(p->here_input);
+    free(p->exec_path);
+    free(p);
 }
@@ -8,6 +8,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 
 //Holds data for the program (or shell built-in) to run
 struct program_data {
@@ -16,11 +17,21 @@ struct program_data {
     char *input_file;       //the file to replace stdin while this program is running
     char *output_file;      //the file to replace stdout while this program is running
     bool append_output;     //if true, we append to output_file, otherwise, we overwrite it
+    char *heredoc_end;      //the line that ends the here-document ('<<'), the body is read by the shell
+    char *here_input;       //text to replace stdin, from a here-document or a here-string ('<<<')
+    size_t here_length;     //number of bytes in here_input
     bool is_piped;          //does this program's output flow to another program's input?
     bool is_daemon;         //should we run this program in the background?
+    char **expanded_argv;   //argv rebuilt by command substitution, NULL if argv was not expanded
+    char *expansion;        //buffer holding the strings that expanded_argv points to
+    char *resolved_name;    //the argv[0] resolved ahead of time by batch mode, NULL if not resolved
+    unsigned resolved_generation;   //resolution is stale once a built-in has run since this generation
+    char *exec_path;        //executable found for resolved_name, NULL if none or a built-in
+    int ibuilt_in;          //built-in found for resolved_name, -1 if none
 };
 
 //tokenizes the whitespace delimited string 'command' into an array of strings
+//a command substitution '$(...)' is kept as one token, even if it contains whitespace
 char **tokenize_command(char *command, int *next);
 
 /* Uses the result of tokenize_command to extract the command's data
@@ -28,4 +39,11 @@ char **tokenize_command(char *command, int *next);
  * Extracted data is saved in an array of struct program_data, must be free'd
  * If parsing fails, -1 is returned, otherwise, 0 is returned
  */
-int parse_command(struct program_data ***pdata, int *next, char **tokens, int size);
\ No newline at end of file
+int parse_command(struct program_data ***pdata, int *next, char **tokens, int size);
+
+//if 'token' starts with '$(', return a pointer to the ')' that closes it, otherwise (or if it is never
+//closed) return NULL
+char *substitution_end(char *token);
+
+//frees a struct produced by parse_command, along with anything command substitution allocated for it
+void free_program_data(struct program_data *p);
@@ -5,6 +5,7 @@
  * Author: Jaffar Alzeidi
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -13,16 +14,53 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "command_parser.h"
 #include "built-ins.h"
+#include "placement.h"
+#include "vector.h"
+#include "queue.h"
+#include "trace.h"
+
+#define BATCH_QUEUE_SIZE 16
+
+//A batch line that the reader thread has tokenized, parsed and resolved, waiting to be run
+struct batch_line {
+    char *line;                     //the line as read, tokens point into it
+    char **tokens;
+    struct program_data **pdata;
+    int size;                       //number of programs in pdata, 0 for a blank line
+    int status;                     //-1 if the line could not be parsed
+    bool eof;                       //no more lines follow this one
+};
+
+//Arguments for the reader thread
+struct batch_reader {
+    FILE *in;
+    struct built_in *b;
+    struct queue *q;
+};
+
+//Built-ins that run in the shell's process can change the environment and the working directory,
+//which the reader thread reads while resolving programs, so they run while holding 'env_lock'
+//Every such run starts a new generation, making older resolutions stale
+static pthread_mutex_t env_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned resolve_generation = 0;
 
 void interactive(struct built_in *b);
 void batch(struct built_in *b, char *batch_file);
+void *read_batch(void *arg);
 
 char *find_executable(char *name);
+bool contains_slash(char *string);
+void find_program(char *pname, char **exec_path, struct built_in *b, int *ibuilt_in);
 int run_command(struct program_data **pdata, size_t size, struct built_in *b);
+int expand_substitutions(struct program_data *p, struct built_in *b);
+int read_heredocs(struct program_data **pdata, size_t size, FILE *in, char *prompt);
+void reserve_buffer(char **buffer, size_t *capacity, size_t needed);
 
 int main(int argc, char **argv) {
     //Set up shell environment
@@ -36,12 +74,23 @@ int main(int argc, char **argv) {
     struct built_in b[NUM_OF_BUILT_INS];
     store_builtins(b);
 
+    //Start tracing if asked to, the remaining arguments select the mode
+    int first_arg = 1;
+    if(argc >= 3 && strcmp(argv[1], "--trace") == 0) {
+        if(trace_open(argv[2]) == -1) {
+            fprintf(stderr, "%s", "An error has occurred\n");
+            exit(1);
+        }
+        trace_thread_name("shell");
+        first_arg = 3;
+    }
+
     //Call the appropriate shell mode
-    if(argc == 1) interactive(b);
-    else if(argc == 2) batch(b, argv[1]);
+    if(argc == first_arg) interactive(b);
+    else if(argc == first_arg + 1) batch(b, argv[first_arg]);
     else {
         printf("%s: invoked with invalid arguments\n", argv[0]);
-        printf("Usage: %s or %s <batch_file>", argv[0], argv[0]);
+        printf("Usage: %s [--trace <trace_file>] [<batch_file> or -]", argv[0]);
     }
 }
 
@@ -64,7 +113,9 @@ void interactive(struct built_in *b) {
         char *line = NULL;
         size_t length = 0;
         errno = 0;
+        long long start = trace_start();
         ssize_t read = getline(&line, &length, stdin);
+        trace_complete("read line", start, read == -1 ? NULL : line);
         if(read == -1) {
             free(line);
             if(errno == 0) {
@@ -76,15 +127,22 @@ void interactive(struct built_in *b) {
 
         //parse and run command if parsing did not fail
         int size = 0;
+        start = trace_start();
         char **tokens = tokenize_command(line, &size);
+        trace_complete("tokenize_command", start, NULL);
         //if tokens[0] is null, the input was either empty or all whitespaces, either case is invalid
         if(tokens[0]) {
             struct program_data **pdata = NULL;
 	        int last_index = 0;
-            if(parse_command(&pdata, &last_index, tokens, size) != -1) {
+            start = trace_start();
+            int status = parse_command(&pdata, &last_index, tokens, size);
+            trace_complete("parse_command", start, tokens[0]);
+            if(status != -1 && read_heredocs(pdata, last_index + 1, stdin, "> ") != -1) {
+                start = trace_start();
                 run_command(pdata, last_index + 1, b);
+                trace_complete("run_command", start, pdata[0]->argv[0]);
             }
-	        for(int i = 0; i <= last_index; i++) free(pdata[i]);
+	        for(int i = 0; i <= last_index; i++) free_program_data(pdata[i]);
 	        free(pdata);
         }
         free(tokens);
@@ -93,33 +151,163 @@ void interactive(struct built_in *b) {
 }
 
 /*
- * Executes commands from a batch file
+ * Executes commands from a batch file, or from stdin if 'batch_file' is "-"
+ * A reader thread tokenizes, parses and resolves upcoming lines into a bounded queue while this thread
+ * runs the current one, so the next command is ready as soon as the current one has been waited on
+ * When reading from stdin, the commands get /dev/null as their stdin so they can't consume the batch
  */
 void batch(struct built_in *b, char *batch_file) {
-    FILE *f = fopen(batch_file, "r");
+    FILE *f = NULL;
+    if(strcmp(batch_file, "-") == 0) {
+        int fd = fcntl(0, F_DUPFD_CLOEXEC, 0);
+        int null_fd = open("/dev/null", O_RDONLY);
+        if(fd != -1 && null_fd != -1 && dup2(null_fd, 0) != -1) f = fdopen(fd, "r");
+        if(null_fd != -1) close(null_fd);
+    } else {
+        f = fopen(batch_file, "re");
+    }
     if(!f) {
         fprintf(stderr, "%s", "An error has occurred\n");
         exit(1);
     }
-    size_t length = 0;
-    char *line = NULL;
-    while(getline(&line, &length, f) != -1) {
+
+    struct queue q;
+    queue_init(&q, BATCH_QUEUE_SIZE);
+    struct batch_reader reader = {f, b, &q};
+    pthread_t reader_thread;
+    if(pthread_create(&reader_thread, NULL, read_batch, &reader) != 0) {
+        fprintf(stderr, "%s", "An error has occurred\n");
+        exit(1);
+    }
+
+    struct batch_line *next = NULL;
+    while(!(next = queue_pop(&q))->eof) {
+        long long start = trace_start();
+        if(next->status == -1 || (next->size > 0 && run_command(next->pdata, next->size, b) == -1)) {
+            fprintf(stderr, "%s", "An error has occurred\n");
+            exit(1);
+        }
+        if(next->size > 0) trace_complete("run_command", start, next->pdata[0]->argv[0]);
+        for(int i = 0; i < next->size; i++) free_program_data(next->pdata[i]);
+        free(next->pdata);
+        free(next->tokens);
+        free(next->line);
+        free(next);
+    }
+    free(next);
+    pthread_join(reader_thread, NULL);
+    queue_destroy(&q);
+    fclose(f);
+}
+
+/*
+ * Resolve the program of 'p' ahead of time, the result is used by run_command if argv[0] and the
+ * generation are unchanged when the program runs
+ * A program that wasn't found is looked up again by run_command, since an earlier command may create it
+ * Paths are left to run_command, since whether they exist depends on the working directory at that time.
+ * So are command substitutions, which only know the program's name once they have run
+ */
+void resolve_ahead(struct program_data *p, struct built_in *b) {
+    char *name = p->argv[0];
+    if(name[0] == '$' || contains_slash(name)) return;
+    long long start = trace_start();
+    pthread_mutex_lock(&env_lock);
+    find_program(name, &p->exec_path, b, &p->ibuilt_in);
+    p->resolved_generation = resolve_generation;
+    pthread_mutex_unlock(&env_lock);
+    trace_complete("find_program", start, name);
+    p->resolved_name = name;
+}
+
+/*
+ * Reader thread of batch mode
+ * Reads lines (and the bodies of their here-documents), parses them, resolves their programs, and
+ * queues them in order. Stops after the last line or the first line that fails to parse
+ */
+void *read_batch(void *arg) {
+    struct batch_reader *reader = arg;
+    trace_thread_name("batch reader");
+    while(1) {
+        struct batch_line *next = calloc(1, sizeof(struct batch_line));
+        if(next == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        size_t length = 0;
+        long long start = trace_start();
+        ssize_t read = getline(&next->line, &length, reader->in);
+        trace_complete("read line", start, read == -1 ? NULL : next->line);
+        if(read == -1) {
+            free(next->line);
+            next->line = NULL;
+            next->eof = true;
+            queue_push(reader->q, next);
+            return NULL;
+        }
         int size = 0;
-        char **tokens = tokenize_command(line, &size);
-        if(tokens[0]) {
+        start = trace_start();
+        next->tokens = tokenize_command(next->line, &size);
+        trace_complete("tokenize_command", start, NULL);
+        if(next->tokens[0]) {
             int last_index = 0;
-            struct program_data **pdata = NULL;
-            if(parse_command(&pdata, &last_index, tokens, size) == -1 || 
-               run_command(pdata, last_index + 1, b) == -1) {
-                fprintf(stderr, "%s", "An error has occurred\n");
-                exit(1);
+            start = trace_start();
+            next->status = parse_command(&next->pdata, &last_index, next->tokens, size);
+            trace_complete("parse_command", start, next->tokens[0]);
+            next->size = last_index + 1;
+            if(next->status != -1) next->status = read_heredocs(next->pdata, next->size, reader->in, NULL);
+            if(next->status != -1) {
+                for(int i = 0; i < next->size; i++) resolve_ahead(next->pdata[i], reader->b);
             }
-	        for(int i = 0; i <= last_index; i++) free(pdata[i]);
-	        free(pdata);
         }
-        free(tokens);
+        bool failed = next->status == -1;     //'next' belongs to the main thread once it is queued
+        queue_push(reader->q, next);
+        if(failed) return NULL;
+    }
+}
+
+/*
+ * Read the body of every here-document in 'pdata' from 'in', in the order the '<<' operators appear
+ * Each body ends at a line that matches the program's heredoc_end exactly, or at EOF
+ * If 'prompt' is not NULL it is printed before every line of the body
+ * Return 0 on success, -1 on failure
+ */
+int read_heredocs(struct program_data **pdata, size_t size, FILE *in, char *prompt) {
+    char *line = NULL;
+    size_t length = 0;
+    for(int i = 0; i < size; i++) {
+        if(pdata[i]->heredoc_end == NULL) continue;
+        char *body = NULL;
+        size_t body_length = 0;
+        size_t capacity = 0;
+        reserve_buffer(&body, &capacity, 1);
+        while(1) {
+            if(prompt) {
+                printf("%s", prompt);
+                fflush(stdout);
+            }
+            errno = 0;
+            ssize_t read = getline(&line, &length, in);
+            if(read == -1) {
+                if(errno == 0) break;
+                free(body);
+                free(line);
+                return -1;
+            }
+            size_t content = (read > 0 && line[read - 1] == '\n') ? read - 1 : read;
+            if(content == strlen(pdata[i]->heredoc_end) && strncmp(line, pdata[i]->heredoc_end, content) == 0) {
+                break;
+            }
+            reserve_buffer(&body, &capacity, body_length + read + 1);
+            memcpy(body + body_length, line, read);
+            body_length += read;
+        }
+        body[body_length] = '\0';
+        free(pdata[i]->here_input);
+        pdata[i]->here_input = body;
+        pdata[i]->here_length = body_length;
     }
     free(line);
+    return 0;
 }
 
 /*
@@ -129,7 +317,8 @@ void batch(struct built_in *b, char *batch_file) {
 char *find_executable(char *name) {
     char *path = getenv("PATH");
     if(path == NULL || (path = strdup(path)) == NULL) return NULL;
-    char *token = strtok(path, ":");
+    char *saveptr = NULL;       //strtok_r, the batch reader thread searches the PATH too
+    char *token = strtok_r(path, ":", &saveptr);
     while(token != NULL) {
         size_t bytes = (strlen(token) + strlen(name) + 2) * sizeof(char); 
         char *executable_path = malloc(bytes);
@@ -139,7 +328,7 @@ char *find_executable(char *name) {
             return executable_path;
         }
         free(executable_path);
-        token = strtok(NULL, ":");
+        token = strtok_r(NULL, ":", &saveptr);
     }
     free(path);
     return NULL;
@@ -184,8 +373,10 @@ void free_resources(int *pipefd, int *stdin_cpy, int *stdout_cpy, char *exec_pat
 
 /*
  * If we have copies of stdio (stdin, stdout), then we use them to restore the originals and close copies
+ * Output buffered by a built-in is flushed first, so that it reaches the file it was redirected to
  */
 void restore_io(int *stdin_cpy, int *stdout_cpy) {
+    fflush(stdout);
     if(*stdin_cpy != -1) { 
         if(dup2(*stdin_cpy, 0) == -1) exit(1);
         Close(stdin_cpy);
@@ -235,6 +426,40 @@ int check_piping(struct program_data **pdata, int i, int *pipefd) {
     return 0;
 }
 
+/*
+ * Return a readable file descriptor holding 'text', to be mapped onto stdin
+ * If 'text' fits in a pipe's capacity it is written to a pipe and the write end is closed, so the
+ * reader sees EOF after the text. Larger text goes into a memfd, which is rewound before returning
+ * Return -1 on failure
+ */
+int here_input_fd(char *text, size_t length) {
+    int fd[2];
+    if(pipe(fd) == -1) return -1;
+    int pipe_size = fcntl(fd[1], F_GETPIPE_SZ);
+    if(pipe_size != -1 && length <= (size_t)pipe_size) {
+        ssize_t written = write(fd[1], text, length);
+        Close(fd + 1);
+        if(written != (ssize_t)length) Close(fd);
+        return fd[0];
+    }
+    Close(fd);
+    Close(fd + 1);
+
+    int memfd = memfd_create("jshell-heredoc", MFD_CLOEXEC);
+    if(memfd == -1) return -1;
+    size_t offset = 0;
+    while(offset < length) {
+        ssize_t written = write(memfd, text + offset, length - offset);
+        if(written == -1) {
+            Close(&memfd);
+            return -1;
+        }
+        offset += written;
+    }
+    if(lseek(memfd, 0, SEEK_SET) == -1) Close(&memfd);
+    return memfd;
+}
+
 /*
  * Check for I/O redirection, mapping stdin and/or stdout accordingly
  * Return 0 on success, -1 on failure
@@ -257,16 +482,23 @@ int check_redirection(struct program_data *pdata, int ibuilt_in) {
         close(input_fd);
         if(status == -1) return -1;
     }
+    if(ibuilt_in == -1 && pdata->here_input) {
+        int input_fd = here_input_fd(pdata->here_input, pdata->here_length);
+        if(input_fd == -1) return -1;
+        int status = dup2(input_fd, 0);
+        close(input_fd);
+        if(status == -1) return -1;
+    }
     return 0;
 }
 
 /*
- * If previous program piped or current program has an input_file, we make a copy of stdin because we
+ * If previous program piped or current program has an input_file or here_input, we make a copy of stdin because we
  * need to remap it, execute program, then restore it
  * If current program is piped or has an output_file, we make a copy of stdout for the same reason above
  */
 int save_stdio(struct program_data **pdata, int i, int *stdin_cpy, int *stdout_cpy) {
-    if((i > 0 && pdata[i-1]->is_piped) || pdata[i]->input_file) {
+    if((i > 0 && pdata[i-1]->is_piped) || pdata[i]->input_file || pdata[i]->here_input) {
         if((*stdin_cpy = dup(0)) == -1) return -1;
     }
     if(pdata[i]->is_piped || pdata[i]->output_file) {
@@ -277,26 +509,37 @@ int save_stdio(struct program_data **pdata, int i, int *stdin_cpy, int *stdout_c
 
 /*
  * Child code after fork
+ * Placement is applied here so that only the child is pinned/reprioritized, never the shell
  */
-void on_fork_child(struct program_data *p, int *pipefd, struct built_in *b, int ibuilt_in, char *exec_path) {
+void on_fork_child(struct program_data *p, int *pipefd, struct built_in *b, int ibuilt_in, char *exec_path,
+                   struct placement *place, int slot) {
     char *shell_path = getenv("shell");
     if(shell_path) {
         setenv("parent", shell_path, 1);
     }
     if(p->is_piped) close(pipefd[0]);
+    apply_placement(place, slot);
     if(ibuilt_in != -1) {
+        trace_child("built-in", p->argv[0]);
         b[ibuilt_in].func(p->argc, p->argv);
         exit(0);
     } 
-    else execv(exec_path, p->argv);
+    else {
+        trace_child("exec", exec_path);
+        execv(exec_path, p->argv);
+    }
 }
 
 /*
  * Parent code after fork
  */ 
-void on_fork_parent(bool is_daemon, char *exec_path, int pid) {
+void on_fork_parent(bool is_daemon, char *exec_path, int pid, char *name) {
     if(exec_path) free(exec_path);
-    if(!is_daemon) waitpid(pid, NULL, 0);
+    if(!is_daemon) {
+        long long start = trace_start();
+        waitpid(pid, NULL, 0);
+        trace_complete("waitpid", start, name);
+    }
 }
 
 void on_fork_error(int *pipefd, int *stdin_cpy, int *stdout_cpy, char *exec_path) {
@@ -305,28 +548,202 @@ void on_fork_error(int *pipefd, int *stdin_cpy, int *stdout_cpy, char *exec_path
     free_resources(pipefd, stdin_cpy, stdout_cpy, exec_path);
 }
 
+/*
+ * Grow the character buffer '*buffer' so that it holds at least 'needed' bytes
+ */
+void reserve_buffer(char **buffer, size_t *capacity, size_t needed) {
+    if(needed <= *capacity) return;
+    while(*capacity < needed) *capacity = *capacity ? *capacity * 2 : 256;
+    char *temp = realloc(*buffer, *capacity);
+    if(temp == NULL) {
+        free(*buffer);
+        perror("realloc");
+        exit(1);
+    }
+    *buffer = temp;
+}
+
+/*
+ * Does any program in 'pdata' take its input from a here-document?
+ */
+bool has_heredoc(struct program_data **pdata, size_t size) {
+    for(int i = 0; i < size; i++) {
+        if(pdata[i]->heredoc_end) return true;
+    }
+    return false;
+}
+
+/*
+ * Run 'command' with stdout mapped to a memfd, then append what it wrote to '*buffer'
+ * A memfd is used rather than a pipe because run_command waits on the command before returning, so a
+ * pipe would only be drained after the fact and would block any command writing more than its capacity
+ * Built-ins run in the shell's process like any other command line, only executables are forked
+ * Here-documents are rejected, a substitution has no lines of its own to read the body from
+ * Return 0 on success, -1 on failure
+ */
+int capture_output(char *command, struct built_in *b, char **buffer, size_t *length, size_t *capacity) {
+    char *line = strdup(command);
+    int size = 0;
+    char **tokens = tokenize_command(line, &size);
+    int status = 0;
+    if(tokens[0]) {
+        struct program_data **pdata = NULL;
+        int last_index = 0;
+        int out_fd = memfd_create("jshell-subst", MFD_CLOEXEC);
+        int stdin_cpy = -1;        //stdin is left alone, only stdout is captured
+        int stdout_cpy = -1;
+        fflush(stdout);
+        if(out_fd == -1 || (stdout_cpy = dup(1)) == -1 || dup2(out_fd, 1) == -1 ||
+           parse_command(&pdata, &last_index, tokens, size) == -1 ||
+           has_heredoc(pdata, last_index + 1) ||
+           run_command(pdata, last_index + 1, b) == -1) {
+            status = -1;
+        }
+        restore_io(&stdin_cpy, &stdout_cpy);
+
+        struct stat st;
+        if(status == 0 && fstat(out_fd, &st) == 0) {
+            reserve_buffer(buffer, capacity, *length + st.st_size + 1);
+            ssize_t bytes = pread(out_fd, *buffer + *length, st.st_size, 0);
+            if(bytes > 0) *length += bytes;
+        }
+        Close(&out_fd);
+        if(pdata) {
+            for(int i = 0; i <= last_index; i++) free_program_data(pdata[i]);
+            free(pdata);
+        }
+    }
+    free(tokens);
+    free(line);
+    return status;
+}
+
+/*
+ * Replace every argument of the form '$(command)' with the output of 'command', split on whitespace
+ * The arguments are copied into one buffer, separated by NUL, and the new argv points into that buffer
+ * Return 0 on success (including when there is nothing to expand), -1 on failure
+ */
+int expand_substitutions(struct program_data *p, struct built_in *b) {
+    //only whole arguments are substituted, 'x$(a)', '$(a)$(b)' or '$(a)b' are rejected rather than half run
+    bool found = false;
+    for(int i = 0; i < p->argc; i++) {
+        char *start = strstr(p->argv[i], "$(");
+        if(start == NULL) continue;
+        if(start != p->argv[i]) return -1;
+        char *end = substitution_end(p->argv[i]);
+        if(end == NULL || end[1] != '\0') return -1;
+        found = true;
+    }
+    if(!found) return 0;
+
+    char *buffer = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    for(int i = 0; i < p->argc; i++) {
+        size_t arg_length = strlen(p->argv[i]);
+        if(strncmp(p->argv[i], "$(", 2) == 0) {
+            p->argv[i][arg_length - 1] = '\0';
+            int status = capture_output(p->argv[i] + 2, b, &buffer, &length, &capacity);
+            p->argv[i][arg_length - 1] = ')';
+            if(status == -1) {
+                free(buffer);
+                return -1;
+            }
+        } else {
+            reserve_buffer(&buffer, &capacity, length + arg_length);
+            memcpy(buffer + length, p->argv[i], arg_length);
+            length += arg_length;
+        }
+        reserve_buffer(&buffer, &capacity, length + 1);
+        buffer[length++] = '\0';
+    }
+
+    //split the buffer into words, whitespace and NUL both end a word
+    int argv_capacity = 8;
+    char **argv = malloc(argv_capacity * sizeof(char *));
+    int argc = 0;
+    for(size_t i = 0; i < length; i++) {
+        char c = buffer[i];
+        if(c == ' ' || c == '\t' || c == '\n' || c == '\0') {
+            buffer[i] = '\0';
+        } else if(i == 0 || buffer[i - 1] == '\0') {
+            argv = check_vector(argv, &argv_capacity, argc);
+            argv[argc++] = buffer + i;
+        }
+    }
+    argv = check_vector(argv, &argv_capacity, argc);
+    argv[argc] = NULL;
+
+    if(argc == 0) {
+        free(argv);
+        free(buffer);
+        return -1;
+    }
+    p->argv = argv;
+    p->argc = argc;
+    p->expanded_argv = argv;
+    p->expansion = buffer;
+    return 0;
+}
+
 /*
  * Run the command using the information from the array 'pdata'
  * If the program to run is an executable, we fork, then exec into its code
  * If it is a built-in, we only fork if the program must run in the background or has piping (to close
  * unused pipe end), then we call the built-in function
  * Otherwise, we just call the built-in function in the shell's process
+ * A program prefixed with 'pin' is always forked, so that its placement never applies to the shell
  * Return 0 on success, -1 on failure
  */
 int run_command(struct program_data **pdata, size_t size, struct built_in *b) {
+    //expand every program before any pipe is created, so commands being substituted don't inherit one
+    for(int i = 0; i < size; i++) {
+        if(expand_substitutions(pdata[i], b) == -1) {
+            fprintf(stderr, "%s", "An error has occurred\n");
+            return -1;
+        }
+    }
+
     int pipefd[] = {-1, -1};
+    int slot = -1;                  //sibling CPU slot of the current program, -1 if it is not piped
     for(int i = 0; i < size; i++) {
         int stdin_cpy = -1;
         int stdout_cpy = -1;
+        if(i > 0 && pdata[i-1]->is_piped) ++slot;
+        else if(pdata[i]->is_piped) {
+            int stages = 1;
+            while(pdata[i + stages - 1]->is_piped) ++stages;
+            slot = reserve_sibling_slots(stages);
+        }
+        else slot = -1;
+
+        struct placement place;
+        init_placement(&place);
+        merge_placement(&place, shell_placement());
+        int pinned = strip_placement_prefix(&place, &pdata[i]->argv, &pdata[i]->argc);
 
         char *exec_path = NULL;     //path of executable to run 
         int ibuilt_in = -1;         //index of built-in in 'b'
-        find_program(pdata[i]->argv[0], &exec_path, b, &ibuilt_in);
+        if(pinned != -1 && pdata[i]->resolved_name == pdata[i]->argv[0] &&
+           pdata[i]->resolved_generation == resolve_generation &&
+           (pdata[i]->exec_path != NULL || pdata[i]->ibuilt_in != -1)) {
+            exec_path = pdata[i]->exec_path;
+            pdata[i]->exec_path = NULL;
+            ibuilt_in = pdata[i]->ibuilt_in;
+        }
+        else if(pinned != -1) {
+            long long start = trace_start();
+            find_program(pdata[i]->argv[0], &exec_path, b, &ibuilt_in);
+            trace_complete("find_program", start, pdata[i]->argv[0]);
+        }
 
-        if((exec_path == NULL && ibuilt_in == -1) ||
-           save_stdio(pdata, i, &stdin_cpy, &stdout_cpy) == -1 || 
-           check_piping(pdata, i, pipefd) == -1 || 
-           check_redirection(pdata[i], ibuilt_in) == -1) {
+        long long start = trace_start();
+        bool failed = (exec_path == NULL && ibuilt_in == -1) ||
+                      save_stdio(pdata, i, &stdin_cpy, &stdout_cpy) == -1 || 
+                      check_piping(pdata, i, pipefd) == -1 || 
+                      check_redirection(pdata[i], ibuilt_in) == -1;
+        trace_complete("redirection", start, pdata[i]->argv[0]);
+        if(failed) {
 
             restore_io(&stdin_cpy, &stdout_cpy);
             free_resources(pipefd, &stdin_cpy, &stdout_cpy, exec_path);
@@ -335,19 +752,29 @@ int run_command(struct program_data **pdata, size_t size, struct built_in *b) {
         }
 
         if(ibuilt_in == -1 || pdata[i]->is_daemon || pdata[i]->is_piped ||
-          (i > 0 && pdata[i-1]->is_piped)) {
+          (i > 0 && pdata[i-1]->is_piped) || pinned) {
+            fflush(stdout);
+            start = trace_start();
             int pid = fork();
-            if(pid > 0) on_fork_parent(pdata[i]->is_daemon, exec_path, pid);
-            else if(pid == 0) on_fork_child(pdata[i], pipefd, b, ibuilt_in, exec_path);
+            if(pid > 0) {
+                trace_complete("fork", start, pdata[i]->argv[0]);
+                on_fork_parent(pdata[i]->is_daemon, exec_path, pid, pdata[i]->argv[0]);
+            }
+            else if(pid == 0) on_fork_child(pdata[i], pipefd, b, ibuilt_in, exec_path, &place, slot);
             else {
                 on_fork_error(pipefd, &stdin_cpy, &stdout_cpy, exec_path);
                 return -1;
             }
         } 
         else {
+            pthread_mutex_lock(&env_lock);
             b[ibuilt_in].func(pdata[i]->argc, pdata[i]->argv);
+            ++resolve_generation;
+            pthread_mutex_unlock(&env_lock);
         }
+        start = trace_start();
         restore_io(&stdin_cpy, &stdout_cpy);
+        trace_complete("restore_io", start, NULL);
         waitpid(-1, NULL, WNOHANG);     //check for and harvest zombie processes
     }
     return 0;
@@ -0,0 +1,271 @@
+/*
+ * placement.c
+ * Part of the 'jshell' project
+ * Implementation of placement.h interface
+ * Author: Jaffar Alzeidi
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "placement.h"
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+static struct placement defaults;
+static bool defaults_ready = false;
+
+//socket and core of every CPU, read from sysfs once so forked children don't have to
+static int cpu_package[CPU_SETSIZE];
+static int cpu_core[CPU_SETSIZE];
+static bool topology_ready = false;
+
+static int next_slot = 0;               //first slot of the next auto-placed pipeline
+
+void init_placement(struct placement *p) {
+    CPU_ZERO(&p->cpus);
+    p->has_cpus = false;
+    p->nice = 0;
+    p->has_nice = false;
+    p->ioprio_class = 0;
+    p->ioprio_level = 0;
+    p->has_ioprio = false;
+    p->auto_place = false;
+}
+
+struct placement *shell_placement(void) {
+    if(!defaults_ready) {
+        init_placement(&defaults);
+        defaults_ready = true;
+    }
+    return &defaults;
+}
+
+/*
+ * Reads a single integer from a sysfs file, -1 if the file can't be read
+ */
+static int read_topology_value(int cpu, const char *name) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *f = fopen(path, "r");
+    if(!f) return -1;
+    int value = -1;
+    if(fscanf(f, "%d", &value) != 1) value = -1;
+    fclose(f);
+    return value;
+}
+
+static void load_topology(void) {
+    if(topology_ready) return;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        cpu_package[cpu] = read_topology_value(cpu, "physical_package_id");
+        cpu_core[cpu] = read_topology_value(cpu, "core_id");
+    }
+    topology_ready = true;
+}
+
+/*
+ * Orders CPUs by socket, then core, so that SMT siblings and neighbouring cores are adjacent
+ */
+static int compare_cpus(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    if(cpu_package[x] != cpu_package[y]) return cpu_package[x] - cpu_package[y];
+    if(cpu_core[x] != cpu_core[y]) return cpu_core[x] - cpu_core[y];
+    return x - y;
+}
+
+/*
+ * Parses a list such as "0-3,8,10-11" into 'set'
+ * Return 0 on success, -1 on failure
+ */
+static int parse_cpu_list(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *s = list;
+    while(*s != '\0') {
+        char *end = NULL;
+        long first = strtol(s, &end, 10);
+        if(end == s) return -1;
+        long last = first;
+        if(*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if(end == s) return -1;
+        }
+        if(first < 0 || last < first || last >= CPU_SETSIZE) return -1;
+        for(long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+        if(*end == ',') ++end;
+        else if(*end != '\0') return -1;
+        s = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/*
+ * Parses "rt", "be" or "idle" (or the class number), optionally followed by ":<level>"
+ * Return 0 on success, -1 on failure
+ */
+static int parse_ioprio(const char *value, struct placement *p) {
+    char name[8];
+    const char *colon = strchr(value, ':');
+    size_t length = colon ? (size_t)(colon - value) : strlen(value);
+    if(length == 0 || length >= sizeof(name)) return -1;
+    memcpy(name, value, length);
+    name[length] = '\0';
+
+    if(strcmp(name, "rt") == 0 || strcmp(name, "1") == 0) p->ioprio_class = 1;
+    else if(strcmp(name, "be") == 0 || strcmp(name, "2") == 0) p->ioprio_class = 2;
+    else if(strcmp(name, "idle") == 0 || strcmp(name, "3") == 0) p->ioprio_class = 3;
+    else return -1;
+
+    p->ioprio_level = 4;
+    if(colon) {
+        char *end = NULL;
+        long level = strtol(colon + 1, &end, 10);
+        if(end == colon + 1 || *end != '\0' || level < 0 || level > 7) return -1;
+        p->ioprio_level = level;
+    }
+    p->has_ioprio = true;
+    return 0;
+}
+
+int parse_placement(struct placement *p, int argc, char **argv) {
+    int i = 0;
+    while(i < argc && argv[i][0] == '-') {
+        char *option = argv[i];
+        if(strcmp(option, "-a") == 0) {
+            p->auto_place = true;
+            load_topology();
+            i++;
+            continue;
+        }
+        if(i + 1 >= argc) return -1;
+        char *value = argv[i + 1];
+        if(strcmp(option, "-c") == 0) {
+            if(parse_cpu_list(value, &p->cpus) == -1) return -1;
+            p->has_cpus = true;
+        } else if(strcmp(option, "-n") == 0) {
+            char *end = NULL;
+            long nice = strtol(value, &end, 10);
+            if(end == value || *end != '\0' || nice < -20 || nice > 19) return -1;
+            p->nice = nice;
+            p->has_nice = true;
+        } else if(strcmp(option, "-i") == 0) {
+            if(parse_ioprio(value, p) == -1) return -1;
+        } else {
+            return -1;
+        }
+        i += 2;
+    }
+    return i;
+}
+
+int strip_placement_prefix(struct placement *p, char ***argv, int *argc) {
+    if(*argc == 0 || strcmp((*argv)[0], "pin") != 0) return 0;
+    int consumed = parse_placement(p, *argc - 1, *argv + 1);
+    if(consumed == -1 || consumed + 1 >= *argc) return -1;
+    *argv += consumed + 1;
+    *argc -= consumed + 1;
+    return 1;
+}
+
+void merge_placement(struct placement *dst, struct placement *src) {
+    if(src->has_cpus) {
+        dst->cpus = src->cpus;
+        dst->has_cpus = true;
+    }
+    if(src->has_nice) {
+        dst->nice = src->nice;
+        dst->has_nice = true;
+    }
+    if(src->has_ioprio) {
+        dst->ioprio_class = src->ioprio_class;
+        dst->ioprio_level = src->ioprio_level;
+        dst->has_ioprio = true;
+    }
+    if(src->auto_place) dst->auto_place = true;
+}
+
+int reserve_sibling_slots(int stages) {
+    int first = next_slot;
+    next_slot = (next_slot + stages) % CPU_SETSIZE;
+    return first;
+}
+
+/*
+ * Picks the CPU for 'slot' out of 'allowed', walking the CPUs in topology order so that a producer
+ * and its consumer (consecutive slots) end up on sibling cores of the same socket
+ * run_command currently waits on each stage before forking the next one, so the stages of a pipeline
+ * never overlap and this doesn't get them a shared cache yet, it only spreads pipelines over the CPUs
+ */
+static void place_on_sibling(cpu_set_t *allowed, int slot) {
+    int order[CPU_SETSIZE];
+    int count = 0;
+    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if(CPU_ISSET(cpu, allowed)) order[count++] = cpu;
+    }
+    if(count == 0) return;
+    load_topology();
+    qsort(order, count, sizeof(int), compare_cpus);
+    CPU_ZERO(allowed);
+    CPU_SET(order[slot % count], allowed);
+}
+
+void apply_placement(struct placement *p, int slot) {
+    bool auto_place = p->auto_place && slot >= 0;
+    if(p->has_cpus || auto_place) {
+        cpu_set_t allowed;
+        if(p->has_cpus) allowed = p->cpus;
+        else if(sched_getaffinity(0, sizeof(allowed), &allowed) == -1) CPU_ZERO(&allowed);
+        if(auto_place) place_on_sibling(&allowed, slot);
+        if(sched_setaffinity(0, sizeof(allowed), &allowed) == -1) perror("sched_setaffinity");
+    }
+    if(p->has_nice && setpriority(PRIO_PROCESS, 0, p->nice) == -1) {
+        perror("setpriority");
+    }
+    if(p->has_ioprio) {
+        int ioprio = (p->ioprio_class << IOPRIO_CLASS_SHIFT) | p->ioprio_level;
+        if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) == -1) perror("ioprio_set");
+    }
+}
+
+void print_placement(struct placement *p) {
+    const char *ioprio_names[] = {"none", "rt", "be", "idle"};
+    bool printed = false;
+    if(p->has_cpus) {
+        printf("-c ");
+        bool first = true;
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(!CPU_ISSET(cpu, &p->cpus)) continue;
+            int last = cpu;
+            while(last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &p->cpus)) last++;
+            printf(first ? "%d" : ",%d", cpu);
+            if(last > cpu) printf("-%d", last);
+            first = false;
+            cpu = last;
+        }
+        printf(" ");
+        printed = true;
+    }
+    if(p->has_nice) {
+        printf("-n %d ", p->nice);
+        printed = true;
+    }
+    if(p->has_ioprio) {
+        printf("-i %s:%d ", ioprio_names[p->ioprio_class], p->ioprio_level);
+        printed = true;
+    }
+    if(p->auto_place) {
+        printf("-a ");
+        printed = true;
+    }
+    if(!printed) printf("none");
+    puts("");
+}
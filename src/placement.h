@@ -0,0 +1,65 @@
+/*
+ * placement.h
+ * CPU affinity, nice value and I/O priority placement for programs run by 'jshell'
+ * Placement comes from two places: shell-wide defaults set with the 'place' built-in, and the 'pin'
+ * prefix, which overrides the defaults for a single program (or pipeline stage)
+ * Includers must define _GNU_SOURCE before any system header, cpu_set_t depends on it
+ * Author: Jaffar Alzeidi
+ */
+
+#include <stdbool.h>
+#include <sched.h>
+
+//Holds the placement to apply to a child process before it execs
+struct placement {
+    cpu_set_t cpus;         //CPUs the program may run on
+    bool has_cpus;          //if false, the program inherits the shell's affinity
+    int nice;               //nice value of the program
+    bool has_nice;
+    int ioprio_class;       //1 = realtime, 2 = best-effort, 3 = idle
+    int ioprio_level;       //0 (highest) to 7 (lowest), ignored for idle
+    bool has_ioprio;
+    bool auto_place;        //put consecutive pipeline stages on sibling cores
+};
+
+//resets 'p' so that nothing is changed when it is applied
+void init_placement(struct placement *p);
+
+//the defaults set by the 'place' built-in, applied to every forked program
+struct placement *shell_placement(void);
+
+/*
+ * Parses the placement options found at the start of 'argv' into 'p'
+ * Options: -c <cpu list>, -n <nice>, -i <class>[:<level>], -a
+ * Parsing stops at the first argument that is not an option
+ * Return the number of arguments consumed, or -1 if an option is invalid
+ */
+int parse_placement(struct placement *p, int argc, char **argv);
+
+/*
+ * If the program in '*argv' is prefixed with 'pin [options]', the options are merged into 'p' and
+ * '*argv'/'*argc' are advanced past the prefix
+ * Return 1 if a prefix was stripped, 0 if there was none, -1 if the prefix is invalid or no
+ * program follows it
+ */
+int strip_placement_prefix(struct placement *p, char ***argv, int *argc);
+
+//copies every option set in 'src' over 'dst'
+void merge_placement(struct placement *dst, struct placement *src);
+
+/*
+ * Reserves 'stages' consecutive slots for a pipeline that is auto-placed, and returns the first one
+ * Each pipeline starts where the previous one ended, so concurrent pipelines don't share CPUs
+ * Must be called in the shell, before forking the pipeline's first stage
+ */
+int reserve_sibling_slots(int stages);
+
+/*
+ * Applies 'p' to the calling process, meant to be called in the child right before exec
+ * 'slot' comes from reserve_sibling_slots plus the program's position in its pipeline, or is -1 for a
+ * program that is not part of a pipeline. auto_place only applies to programs that have a slot
+ */
+void apply_placement(struct placement *p, int slot);
+
+//prints the options set in 'p' in the same syntax that parse_placement accepts
+void print_placement(struct placement *p);
@@ -0,0 +1,53 @@
+/*
+ * queue.c
+ * Part of the 'jshell' project
+ * Implementation of queue.h interface
+ * Author: Jaffar Alzeidi
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "queue.h"
+
+void queue_init(struct queue *q, int capacity) {
+    q->items = malloc(capacity * sizeof(void *));
+    if(q->items == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+void queue_push(struct queue *q, void *item) {
+    pthread_mutex_lock(&q->lock);
+    while(q->count == q->capacity) pthread_cond_wait(&q->not_full, &q->lock);
+    q->items[(q->head + q->count) % q->capacity] = item;
+    ++q->count;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void *queue_pop(struct queue *q) {
+    pthread_mutex_lock(&q->lock);
+    while(q->count == 0) pthread_cond_wait(&q->not_empty, &q->lock);
+    void *item = q->items[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    --q->count;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+void queue_destroy(struct queue *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->items);
+    q->items = NULL;
+}
@@ -0,0 +1,30 @@
+/*
+ * queue.h
+ * Bounded, thread-safe FIFO of pointers
+ * Used by batch mode to hand lines that were parsed ahead of time to the thread that runs them
+ * Author: Jaffar Alzeidi
+ */
+
+#include <pthread.h>
+
+struct queue {
+    void **items;               //ring buffer of 'capacity' pointers
+    int capacity;
+    int head;                   //index of the oldest item
+    int count;                  //number of items currently in the queue
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+//allocates the ring buffer for 'capacity' items, exits if allocation fails
+void queue_init(struct queue *q, int capacity);
+
+//adds 'item' at the back of the queue, blocks while the queue is full
+void queue_push(struct queue *q, void *item);
+
+//removes and returns the item at the front of the queue, blocks while the queue is empty
+void *queue_pop(struct queue *q);
+
+//frees the ring buffer, the queue must not be in use by any thread
+void queue_destroy(struct queue *q);
@@ -0,0 +1,256 @@
+/*
+ * trace.c
+ * Part of the 'jshell' project
+ * Implementation of trace.h interface
+ * Each thread owns a ring of events with a single writer (the thread) and a single reader (the background
+ * writer), so the two only need atomic head/tail indexes. When a ring is full, events are dropped and
+ * counted rather than making the shell wait
+ * Author: Jaffar Alzeidi
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define TRACE_RING_SIZE 4096            //events per thread, must be a power of 2
+#define TRACE_DETAIL_SIZE 64
+#define TRACE_LINE_SIZE 512
+#define TRACE_FLUSH_INTERVAL_MS 20
+
+struct trace_event {
+    const char *name;
+    char phase;                         //'X' for complete events, 'i' for instant events
+    long long ts;
+    long long dur;
+    char detail[TRACE_DETAIL_SIZE];
+};
+
+struct trace_ring {
+    struct trace_event events[TRACE_RING_SIZE];
+    atomic_uint head;                   //next slot the owning thread writes
+    atomic_uint tail;                   //next slot the background writer reads
+    atomic_ulong dropped;
+    int tid;
+    const char *name;
+    struct trace_ring *next;
+};
+
+static int trace_fd = -1;
+static pid_t trace_pid;                 //forked children inherit trace_fd, only this process owns the trace
+static _Atomic(struct trace_ring *) rings = NULL;
+static __thread struct trace_ring *own_ring = NULL;
+static pthread_t writer_thread;
+static atomic_bool stopping = false;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/*
+ * Write all of 'buffer' to the trace file, the file is opened with O_APPEND so a child's line is never
+ * written into the middle of one of ours
+ */
+static void write_all(const char *buffer, size_t length) {
+    while(length > 0) {
+        ssize_t written = write(trace_fd, buffer, length);
+        if(written <= 0) return;
+        buffer += written;
+        length -= written;
+    }
+}
+
+/*
+ * Length of the UTF-8 character starting at 's', or 0 if 's' does not start a well-formed one
+ */
+static int utf8_length(const unsigned char *s) {
+    int length;
+    if(s[0] >= 0xc2 && s[0] <= 0xdf) length = 2;
+    else if(s[0] >= 0xe0 && s[0] <= 0xef) length = 3;
+    else if(s[0] >= 0xf0 && s[0] <= 0xf4) length = 4;
+    else return 0;
+    for(int i = 1; i < length; i++) {
+        if((s[i] & 0xc0) != 0x80) return 0;
+    }
+    return length;
+}
+
+/*
+ * Copy 'detail' into 'out' as the contents of a JSON string, truncating it to fit
+ * Truncation never splits a UTF-8 character, and bytes that aren't valid UTF-8 are escaped, so the
+ * result is always a valid JSON string
+ */
+static void escape_detail(char *out, size_t size, const char *detail) {
+    size_t j = 0;
+    const unsigned char *d = (const unsigned char *)detail;
+    for(size_t i = 0; d && d[i] != '\0' && j + 7 < size; i++) {
+        unsigned char c = d[i];
+        int length = c >= 0x80 ? utf8_length(d + i) : 1;
+        if(c == '"' || c == '\\') {
+            out[j++] = '\\';
+            out[j++] = c;
+        } else if(c < 0x20 || length == 0) {
+            j += snprintf(out + j, size - j, "\\u%04x", c);
+        } else if(length > 1) {
+            memcpy(out + j, d + i, length);
+            j += length;
+            i += length - 1;
+        } else {
+            out[j++] = c;
+        }
+    }
+    out[j] = '\0';
+}
+
+static size_t format_event(char *line, struct trace_event *e, int pid, int tid) {
+    int length;
+    if(e->phase == 'X') {
+        length = snprintf(line, TRACE_LINE_SIZE,
+                          "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d,"
+                          "\"args\":{\"detail\":\"%s\"}},\n", e->name, e->ts, e->dur, pid, tid, e->detail);
+    } else {
+        length = snprintf(line, TRACE_LINE_SIZE,
+                          "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%d,\"tid\":%d,"
+                          "\"args\":{\"detail\":\"%s\"}},\n", e->name, e->ts, pid, tid, e->detail);
+    }
+    return length < TRACE_LINE_SIZE ? length : TRACE_LINE_SIZE - 1;
+}
+
+/*
+ * Move every event recorded so far from the rings to the trace file
+ */
+static void drain_rings(void) {
+    static char chunk[64 * 1024];
+    size_t used = 0;
+    for(struct trace_ring *r = atomic_load(&rings); r != NULL; r = r->next) {
+        unsigned tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&r->head, memory_order_acquire);
+        for(; tail != head; tail++) {
+            if(used + TRACE_LINE_SIZE > sizeof(chunk)) {
+                write_all(chunk, used);
+                used = 0;
+            }
+            used += format_event(chunk + used, &r->events[tail & (TRACE_RING_SIZE - 1)], trace_pid, r->tid);
+        }
+        atomic_store_explicit(&r->tail, tail, memory_order_release);
+    }
+    if(used > 0) write_all(chunk, used);
+}
+
+static void *write_trace(void *arg) {
+    struct timespec interval = {0, TRACE_FLUSH_INTERVAL_MS * 1000000L};
+    while(!atomic_load(&stopping)) {
+        nanosleep(&interval, NULL);
+        drain_rings();
+    }
+    return NULL;
+}
+
+/*
+ * Stop the background writer, write what is left and close the JSON array
+ * Thread names and dropped event counts are written last, as metadata events
+ */
+static void trace_close(void) {
+    if(trace_fd == -1 || getpid() != trace_pid) return;
+    atomic_store(&stopping, true);
+    pthread_join(writer_thread, NULL);
+    drain_rings();
+
+    char line[TRACE_LINE_SIZE];
+    for(struct trace_ring *r = atomic_load(&rings); r != NULL; r = r->next) {
+        int length = snprintf(line, sizeof(line),
+                              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                              "\"args\":{\"name\":\"%s\",\"dropped_events\":%lu}},\n",
+                              trace_pid, r->tid, r->name ? r->name : "thread", atomic_load(&r->dropped));
+        write_all(line, length);
+    }
+    int length = snprintf(line, sizeof(line),
+                          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"jshell\"}}\n]\n",
+                          trace_pid);
+    write_all(line, length);
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+int trace_open(const char *path) {
+    trace_fd = open(path, O_CREAT | O_WRONLY | O_TRUNC | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if(trace_fd == -1) return -1;
+    trace_pid = getpid();
+    write_all("[\n", 2);
+    if(pthread_create(&writer_thread, NULL, write_trace, NULL) != 0) {
+        close(trace_fd);
+        trace_fd = -1;
+        return -1;
+    }
+    atexit(trace_close);
+    return 0;
+}
+
+/*
+ * Return the calling thread's ring, allocating and registering it on first use
+ */
+static struct trace_ring *get_ring(void) {
+    if(own_ring) return own_ring;
+    struct trace_ring *r = calloc(1, sizeof(struct trace_ring));
+    if(r == NULL) return NULL;
+    r->tid = syscall(SYS_gettid);
+    r->next = atomic_load(&rings);
+    while(!atomic_compare_exchange_weak(&rings, &r->next, r));
+    own_ring = r;
+    return r;
+}
+
+static void record(const char *name, char phase, long long ts, long long dur, const char *detail) {
+    struct trace_ring *r = get_ring();
+    if(r == NULL) return;
+    unsigned head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if(head - tail >= TRACE_RING_SIZE) {
+        atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    struct trace_event *e = &r->events[head & (TRACE_RING_SIZE - 1)];
+    e->name = name;
+    e->phase = phase;
+    e->ts = ts;
+    e->dur = dur;
+    escape_detail(e->detail, sizeof(e->detail), detail);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+    if(trace_fd == -1) return;
+    struct trace_ring *r = get_ring();
+    if(r) r->name = name;
+}
+
+long long trace_start(void) {
+    if(trace_fd == -1) return 0;
+    return now_us();
+}
+
+void trace_complete(const char *name, long long start, const char *detail) {
+    if(trace_fd == -1) return;
+    record(name, 'X', start, now_us() - start, detail);
+}
+
+void trace_child(const char *name, const char *detail) {
+    if(trace_fd == -1) return;
+    struct trace_event e = {name, 'i', now_us(), 0, ""};
+    escape_detail(e.detail, sizeof(e.detail), detail);
+    char line[TRACE_LINE_SIZE];
+    int pid = getpid();
+    size_t length = format_event(line, &e, pid, pid);
+    write_all(line, length);
+}
@@ -0,0 +1,26 @@
+/*
+ * trace.h
+ * Execution trace for 'jshell', written in the Chrome trace-event JSON format so that a whole run can be
+ * viewed as a timeline (chrome://tracing, Perfetto)
+ * Every thread records events into its own buffer without taking locks, a background thread writes
+ * the buffers to the trace file
+ * When no trace is open, every function returns right away
+ * Author: Jaffar Alzeidi
+ */
+
+//opens 'path' for the trace and starts the background writer, the trace is completed at exit
+//Return 0 on success, -1 on failure
+int trace_open(const char *path);
+
+//names the calling thread in the timeline
+void trace_thread_name(const char *name);
+
+//timestamp in microseconds to pass to trace_complete, 0 when no trace is open
+long long trace_start(void);
+
+//records the event 'name' that ran from 'start' until now, 'detail' may be NULL
+//'name' must be a string literal (or otherwise outlive the trace), 'detail' is copied
+void trace_complete(const char *name, long long start, const char *detail);
+
+//records an instant event from a forked child, written straight to the file since the child has no writer
+void trace_child(const char *name, const char *detail);